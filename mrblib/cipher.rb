@@ -8,11 +8,18 @@ module PolarSSL
       "DES-CBC",
       "DES-ECB",
       "DES3-CBC",
-      "DES3-ECB"
-    ]
+      "DES3-ECB",
+      "AES-CTR",
+      "AES-GCM"
+    ].select do |algorithm|
+      name, mode = algorithm.split("-")
+      const_defined?(name) &&
+        (!const_get(name).const_defined?(:MODES) || const_get(name)::MODES.include?(mode))
+    end
 
     attr_accessor :padding, :key, :source, :bkey, :bsource, :iv, :biv
     attr_reader :length, :algorithm, :name, :mode, :final, :cipher, :type
+    attr_accessor :tag
 
     def initialize(algorithm)
       unless PolarSSL::Cipher.ciphers.include?(algorithm)
@@ -57,6 +64,43 @@ module PolarSSL
       bin = self.cipher.send("#{self.type}", self.mode, self.bkey, self.bsource, self.biv.to_s)
       bin.to_s.unpack("H*").first.to_s.upcase
     end
+
+    # Encrypts a binary String on native threads and returns the binary
+    # ciphertext. For GCM the authentication tag is left in #tag.
+    def encrypt_buffer(data)
+      check_type(:encrypt)
+      output, @tag = self.cipher.encrypt_buffer(self.mode, self.bkey, data, self.biv.to_s)
+      output
+    end
+
+    # Decrypts a binary String on native threads. For GCM, #tag must be set
+    # and a CipherError is raised if it does not match.
+    def decrypt_buffer(data)
+      check_type(:decrypt)
+      self.cipher.decrypt_buffer(self.mode, self.bkey, data, self.biv.to_s, @tag)
+    end
+
+    # Encrypts in_path into out_path on native threads. For GCM the
+    # authentication tag is left in #tag.
+    def encrypt_file(in_path, out_path)
+      check_type(:encrypt)
+      @tag = self.cipher.encrypt_file(self.mode, self.bkey, in_path, out_path, self.biv.to_s)
+      true
+    end
+
+    # Decrypts in_path into out_path on native threads. For GCM, #tag must be
+    # set; on a mismatch out_path is removed and a CipherError is raised.
+    def decrypt_file(in_path, out_path)
+      check_type(:decrypt)
+      self.cipher.decrypt_file(self.mode, self.bkey, in_path, out_path, self.biv.to_s, @tag)
+      true
+    end
+
+    def check_type(type)
+      unless self.type == type
+        raise PolarSSL::CipherError.new("cipher is not set up to #{type}")
+      end
+    end
   end
 end
 
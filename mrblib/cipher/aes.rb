@@ -0,0 +1,33 @@
+module PolarSSL
+  class Cipher
+    if const_defined? :AES
+      class AES
+        TAG_LENGTH = 16
+
+        def initialize(algorithm)
+          super("#{self.name}-#{algorithm}")
+        end
+
+        def name
+          "AES"
+        end
+
+        # GCM output is the ciphertext followed by the authentication tag.
+        def self.encrypt(mode, key, source, iv)
+          output, tag = encrypt_buffer(mode, key, source, iv)
+          tag ? output + tag : output
+        end
+
+        # GCM input is the ciphertext followed by the authentication tag.
+        def self.decrypt(mode, key, source, iv)
+          return decrypt_buffer(mode, key, source, iv, nil) unless mode == "GCM"
+          if source.size < TAG_LENGTH
+            raise PolarSSL::CipherError.new("AES-GCM input is shorter than its tag")
+          end
+          length = source.size - TAG_LENGTH
+          decrypt_buffer(mode, key, source[0, length], iv, source[length, TAG_LENGTH])
+        end
+      end
+    end
+  end
+end
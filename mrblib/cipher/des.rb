@@ -1,14 +1,15 @@
 module PolarSSL
   class Cipher
-    class DES
-      def initialize(algorithm)
-        super("#{self.name}-#{algorithm}")
-      end
+    if const_defined? :DES
+      class DES
+        def initialize(algorithm)
+          super("#{self.name}-#{algorithm}")
+        end
 
-      def name
-        "DES"
+        def name
+          "DES"
+        end
       end
     end
   end
 end
-
@@ -1,14 +1,15 @@
 module PolarSSL
   class Cipher
-    class DES3
-      def initialize(algorithm)
-        super("#{self.name}-#{algorithm}")
-      end
+    if const_defined? :DES3
+      class DES3
+        def initialize(algorithm)
+          super("#{self.name}-#{algorithm}")
+        end
 
-      def name
-        "DES3"
+        def name
+          "DES3"
+        end
       end
     end
   end
 end
-
@@ -5,8 +5,10 @@ if Object.const_defined? :PolarSSL
     class MallocFailed < StandardError; end
     class NetWantRead < StandardError; end
     class NetWantWrite < StandardError; end
-    class SSL
-      class Error < RuntimeError; end
+    if const_defined? :SSL
+      class SSL
+        class Error < RuntimeError; end
+      end
     end
   end
 end
\ No newline at end of file
@@ -26,3 +26,20 @@ MRuby::Build.new do |conf|
 
   conf.gem File.expand_path(File.dirname(__FILE__))
 end
+
+# Slim profile: checks that a generated config passes check_config.h, links,
+# and that the tests skip the classes it leaves out.
+MRuby::Build.new('slim') do |conf|
+  toolchain :gcc
+  conf.gembox 'default'
+  conf.enable_test if conf.respond_to?(:enable_test)
+
+  conf.gem :git => 'git@github.com:iij/mruby-io.git'
+  conf.gem :git => 'git@github.com:iij/mruby-pack.git'
+  conf.gem :git => 'git@github.com:iij/mruby-socket.git'
+  conf.gem :git => 'git@github.com:iij/mruby-mtest.git'
+
+  conf.gem File.expand_path(File.dirname(__FILE__)) do |spec|
+    spec.polarssl_features = [:aes_gcm, :tls_client]
+  end
+end
@@ -2,6 +2,8 @@
 #include "mruby/class.h"
 #include "mruby/data.h"
 #include "mruby/string.h"
+#include "mruby/array.h"
+#include "mruby/hash.h"
 #include "mruby/ext/io.h"
 
 #include "mruby/variable.h"
@@ -10,7 +12,10 @@
 #include "polarssl/ctr_drbg.h"
 #include "polarssl/ssl.h"
 #include "polarssl/des.h"
+#include "polarssl/aes.h"
+#include "polarssl/gcm.h"
 #include "polarssl/base64.h"
+#include "polarssl/md.h"
 #include "polarssl/version.h"
 
 #if defined(_WIN32)
@@ -18,6 +23,12 @@
 #define ioctl ioctlsocket
 #else
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
 #endif
 
 /*ECDSA*/
@@ -25,6 +36,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <limits.h>
+#include <stdint.h>
 
 #if MRUBY_RELEASE_NO < 10000
 static struct RClass *mrb_module_get(mrb_state *mrb, const char *name) {
@@ -35,6 +48,11 @@ static struct RClass *mrb_module_get(mrb_state *mrb, const char *name) {
 
 extern struct mrb_data_type mrb_io_type;
 
+#if defined(POLARSSL_CIPHER_MODE_CTR) || defined(POLARSSL_GCM_C)
+#define MRB_POLARSSL_AES_PARALLEL
+#endif
+
+#if defined(POLARSSL_SSL_TLS_C)
 static void mrb_ssl_free(mrb_state *mrb, void *ptr) {
   ssl_context *ssl = ptr;
 
@@ -43,10 +61,13 @@ static void mrb_ssl_free(mrb_state *mrb, void *ptr) {
     mrb_free(mrb, ssl);
   }
 }
+#endif
 
 static struct mrb_data_type mrb_entropy_type = { "Entropy", mrb_free };
 static struct mrb_data_type mrb_ctr_drbg_type = { "CtrDrbg", mrb_free };
+#if defined(POLARSSL_SSL_TLS_C)
 static struct mrb_data_type mrb_ssl_type = { "SSL", mrb_ssl_free };
+#endif
 
 static void entropycheck(mrb_state *mrb, mrb_value self, entropy_context **entropyp) {
   entropy_context *entropy;
@@ -125,6 +146,7 @@ static mrb_value mrb_ctrdrbg_initialize(mrb_state *mrb, mrb_value self) {
   return self;
 }
 
+#if defined(POLARSSL_SELF_TEST)
 static mrb_value mrb_ctrdrbg_self_test() {
   if( ctr_drbg_self_test(0) == 0 ) {
     return mrb_true_value();
@@ -132,12 +154,15 @@ static mrb_value mrb_ctrdrbg_self_test() {
     return mrb_false_value();
   }
 }
+#endif
 
 #define E_MALLOC_FAILED (mrb_class_get_under(mrb,mrb_class_get(mrb, "PolarSSL"),"MallocFailed"))
 #define E_NETWANTREAD (mrb_class_get_under(mrb,mrb_class_get(mrb, "PolarSSL"),"NetWantRead"))
 #define E_NETWANTWRITE (mrb_class_get_under(mrb,mrb_class_get(mrb, "PolarSSL"),"NetWantWrite"))
 #define E_SSL_ERROR (mrb_class_get_under(mrb,mrb_class_get_under(mrb,mrb_module_get(mrb, "PolarSSL"),"SSL"), "Error"))
+#define E_CIPHER_ERROR (mrb_class_get_under(mrb,mrb_module_get(mrb, "PolarSSL"),"CipherError"))
 
+#if defined(POLARSSL_SSL_TLS_C)
 static mrb_value mrb_ssl_initialize(mrb_state *mrb, mrb_value self) {
   ssl_context *ssl;
   int ret;
@@ -317,7 +342,9 @@ static mrb_value mrb_ssl_fileno(mrb_state *mrb, mrb_value self) {
 
   return mrb_fixnum_value(fd);
 }
+#endif
 
+#if defined(POLARSSL_ECDSA_C)
 static void mrb_ecdsa_free(mrb_state *mrb, void *ptr) {
   ecdsa_context *ecdsa = ptr;
 
@@ -481,7 +508,9 @@ static mrb_value mrb_ecdsa_sign(mrb_state *mrb, mrb_value self) {
     return mrb_fixnum_value(ret);
   }
 }
+#endif
 
+#if defined(POLARSSL_DES_C)
 static mrb_value mrb_des_encrypt(mrb_state *mrb, mrb_value self) {
   mrb_value mode, key, source, dest, iv;
   unsigned char output[100];
@@ -609,7 +638,9 @@ static mrb_value mrb_des3_decrypt(mrb_state *mrb, mrb_value self) {
   des3_free(&ctx);
   return mrb_str_new(mrb, output, len);
 }
+#endif
 
+#if defined(POLARSSL_BASE64_C)
 static mrb_value mrb_base64_encode(mrb_state *mrb, mrb_value self) {
   mrb_value src;
   size_t len;
@@ -639,12 +670,919 @@ static mrb_value mrb_base64_decode(mrb_state *mrb, mrb_value self) {
 
   return mrb_str_new(mrb, buffer, len);
 }
+#endif
+
+#if defined(POLARSSL_PKCS5_C) || defined(MRB_POLARSSL_AES_PARALLEL)
+static mrb_int worker_count(mrb_int jobs) {
+  long ncpu = 1;
+
+#if !defined(_WIN32) && defined(_SC_NPROCESSORS_ONLN)
+  ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  if (ncpu < 1) ncpu = 1;
+#endif
+  return jobs < ncpu ? jobs : (mrb_int)ncpu;
+}
+
+/*
+ * Calls fn on each of the count items, items 1..count-1 on native threads and
+ * item 0 on the caller thread. fn must not touch the mrb_state. Never raises:
+ * items whose thread cannot be started run on the caller thread instead.
+ */
+static void run_workers(void *(*fn)(void *), void *items, size_t item_size, mrb_int count) {
+  char *base = items;
+  mrb_int i;
+#if !defined(_WIN32)
+  pthread_t *threads;
+  int *started;
+#endif
+
+  if (count < 1) return;
+
+#if !defined(_WIN32)
+  threads = (pthread_t *)malloc(sizeof(pthread_t) * count);
+  started = (int *)calloc(count, sizeof(int));
+  if (threads != NULL && started != NULL) {
+    for (i = 1; i < count; i++) {
+      started[i] = pthread_create(&threads[i], NULL, fn, base + item_size * i) == 0;
+    }
+    fn(base);
+    for (i = 1; i < count; i++) {
+      if (started[i]) {
+        pthread_join(threads[i], NULL);
+      } else {
+        fn(base + item_size * i);
+      }
+    }
+    free(started);
+    free(threads);
+    return;
+  }
+  free(started);
+  free(threads);
+#endif
+
+  for (i = 0; i < count; i++) {
+    fn(base + item_size * i);
+  }
+}
+#endif
+
+#if defined(POLARSSL_PKCS5_C)
+#define KDF_DEFAULT_DIGEST "SHA256"
+
+typedef struct {
+  const md_info_t *md_info;
+  const unsigned char *password;
+  size_t plen;
+  const unsigned char *salt;
+  size_t slen;
+  unsigned int iterations;
+  uint32_t length;
+  unsigned char *output;
+  int ret;
+} kdf_pbkdf2_job;
+
+typedef struct {
+  kdf_pbkdf2_job *jobs;
+  mrb_int count;
+  mrb_int offset;
+  mrb_int stride;
+} kdf_pbkdf2_worker;
+
+/*
+ * PBKDF2-HMAC as in RFC 2898 5.2, without touching the mrb_state so it is
+ * safe to call from a native worker thread. pkcs5_pbkdf2_hmac() calls
+ * md_hmac_starts() on every iteration, rebuilding the padded key each time;
+ * here the key is set up once and every iteration only rewinds it with
+ * md_hmac_reset().
+ */
+static void kdf_pbkdf2_run(kdf_pbkdf2_job *job) {
+  md_context_t ctx;
+  unsigned char u[POLARSSL_MD_MAX_SIZE], t[POLARSSL_MD_MAX_SIZE], counter[4];
+  unsigned char *output = job->output;
+  uint32_t left = job->length, block = 1;
+  unsigned int i;
+  size_t md_size, j, n;
+  int ret;
+
+  md_init(&ctx);
+  ret = md_init_ctx(&ctx, job->md_info);
+  if (ret == 0) {
+    ret = md_hmac_starts(&ctx, job->password, job->plen);
+  }
+  md_size = md_get_size(job->md_info);
+
+  while (ret == 0 && left > 0) {
+    counter[0] = (unsigned char)(block >> 24);
+    counter[1] = (unsigned char)(block >> 16);
+    counter[2] = (unsigned char)(block >> 8);
+    counter[3] = (unsigned char)(block);
+
+    if ((ret = md_hmac_reset(&ctx)) != 0) break;
+    md_hmac_update(&ctx, job->salt, job->slen);
+    md_hmac_update(&ctx, counter, 4);
+    md_hmac_finish(&ctx, u);
+    memcpy(t, u, md_size);
+
+    for (i = 1; i < job->iterations; i++) {
+      if ((ret = md_hmac_reset(&ctx)) != 0) break;
+      md_hmac_update(&ctx, u, md_size);
+      md_hmac_finish(&ctx, u);
+      for (j = 0; j < md_size; j++) {
+        t[j] ^= u[j];
+      }
+    }
+
+    n = left < md_size ? left : md_size;
+    memcpy(output, t, n);
+    output += n;
+    left   -= n;
+    block++;
+  }
+
+  memset(u, 0, sizeof(u));
+  memset(t, 0, sizeof(t));
+  md_free(&ctx);
+  job->ret = ret;
+}
+
+static void *kdf_pbkdf2_worker_run(void *arg) {
+  kdf_pbkdf2_worker *worker = arg;
+  mrb_int i;
+
+  for (i = worker->offset; i < worker->count; i += worker->stride) {
+    kdf_pbkdf2_run(&worker->jobs[i]);
+  }
+  return NULL;
+}
+
+/* Spreads the jobs round-robin over native threads; the caller thread takes share 0. */
+static void kdf_pbkdf2_run_all(mrb_state *mrb, kdf_pbkdf2_job *jobs, mrb_int count) {
+  kdf_pbkdf2_worker *workers;
+  mrb_int nworkers, i;
+
+  nworkers = worker_count(count);
+  if (nworkers < 1) return;
+
+  workers = (kdf_pbkdf2_worker *)mrb_malloc(mrb, sizeof(kdf_pbkdf2_worker) * nworkers);
+  for (i = 0; i < nworkers; i++) {
+    workers[i].jobs   = jobs;
+    workers[i].count  = count;
+    workers[i].offset = i;
+    workers[i].stride = nworkers;
+  }
+
+  run_workers(kdf_pbkdf2_worker_run, workers, sizeof(kdf_pbkdf2_worker), nworkers);
+
+  mrb_free(mrb, workers);
+}
+
+static const md_info_t *kdf_md_info(mrb_state *mrb, mrb_value digest) {
+  const md_info_t *md_info;
+
+  if (mrb_nil_p(digest)) {
+    digest = mrb_str_new_cstr(mrb, KDF_DEFAULT_DIGEST);
+  } else if (mrb_symbol_p(digest)) {
+    digest = mrb_sym2str(mrb, mrb_symbol(digest));
+  }
+  digest = mrb_str_to_str(mrb, digest);
+  md_info = md_info_from_string(mrb_str_to_cstr(mrb, digest));
+  if (md_info == NULL) {
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "unknown digest: %S", digest);
+  }
+  return md_info;
+}
+
+static void kdf_pbkdf2_job_set(mrb_state *mrb, kdf_pbkdf2_job *job, mrb_value password,
+    mrb_value salt, mrb_int iterations, mrb_int length, mrb_value digest) {
+  mrb_check_type(mrb, password, MRB_TT_STRING);
+  mrb_check_type(mrb, salt, MRB_TT_STRING);
+
+  if (iterations < 1 || (uint64_t)iterations > UINT_MAX) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "iterations out of range");
+  }
+  if (length < 1 || (uint64_t)length > UINT32_MAX) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "length out of range");
+  }
+
+  job->md_info    = kdf_md_info(mrb, digest);
+  job->password   = (const unsigned char *)RSTRING_PTR(password);
+  job->plen       = RSTRING_LEN(password);
+  job->salt       = (const unsigned char *)RSTRING_PTR(salt);
+  job->slen       = RSTRING_LEN(salt);
+  job->iterations = (unsigned int)iterations;
+  job->length     = (uint32_t)length;
+  job->output     = NULL;
+  job->ret        = 0;
+}
+
+static mrb_value mrb_kdf_pbkdf2(mrb_state *mrb, mrb_value self) {
+  mrb_value password, salt, opts = mrb_nil_value(), digest = mrb_nil_value(), key;
+  mrb_int iterations, length;
+  kdf_pbkdf2_job job;
+
+  mrb_get_args(mrb, "SSii|H", &password, &salt, &iterations, &length, &opts);
+
+  if (mrb_hash_p(opts)) {
+    digest = mrb_hash_get(mrb, opts, mrb_symbol_value(mrb_intern_lit(mrb, "digest")));
+  }
+  kdf_pbkdf2_job_set(mrb, &job, password, salt, iterations, length, digest);
+
+  key = mrb_str_new(mrb, NULL, length);
+  job.output = (unsigned char *)RSTRING_PTR(key);
+  kdf_pbkdf2_run(&job);
+
+  if (job.ret != 0) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "PBKDF2 derivation failed");
+  }
+  return key;
+}
+
+/*
+ * Derives every [password, salt, iterations, length(, digest)] entry of the
+ * list on native worker threads and returns the keys in the same order.
+ */
+static mrb_value mrb_kdf_pbkdf2_many(mrb_state *mrb, mrb_value self) {
+  mrb_value list, entry, keys, hold, buf, password, salt, digest, key;
+  mrb_int count, i, iterations, length;
+  kdf_pbkdf2_job *jobs;
+  int ai;
+
+  mrb_get_args(mrb, "A", &list);
+
+  count = RARRAY_LEN(list);
+  keys  = mrb_ary_new_capa(mrb, count);
+  if (count == 0) return keys;
+
+  /*
+   * The job table lives in a String and the inputs are copied into hold, so
+   * everything is GC-owned: a raise (or a user to_int/to_str mutating the
+   * list) can neither leak nor invalidate what the workers read.
+   */
+  hold = mrb_ary_new_capa(mrb, count * 2);
+  buf  = mrb_str_new(mrb, NULL, sizeof(kdf_pbkdf2_job) * count);
+  jobs = (kdf_pbkdf2_job *)RSTRING_PTR(buf);
+
+  for (i = 0; i < count; i++) {
+    ai    = mrb_gc_arena_save(mrb);
+    entry = mrb_ary_ref(mrb, list, i);
+    if (!mrb_array_p(entry) || RARRAY_LEN(entry) < 4 || RARRAY_LEN(entry) > 5) {
+      mrb_raise(mrb, E_ARGUMENT_ERROR, "expected [password, salt, iterations, length(, digest)]");
+    }
+    iterations = mrb_fixnum(mrb_to_int(mrb, mrb_ary_ref(mrb, entry, 2)));
+    length     = mrb_fixnum(mrb_to_int(mrb, mrb_ary_ref(mrb, entry, 3)));
+    digest     = mrb_ary_ref(mrb, entry, 4);
+    password   = mrb_ary_ref(mrb, entry, 0);
+    salt       = mrb_ary_ref(mrb, entry, 1);
+    mrb_check_type(mrb, password, MRB_TT_STRING);
+    mrb_check_type(mrb, salt, MRB_TT_STRING);
+    password = mrb_str_dup(mrb, password);
+    salt     = mrb_str_dup(mrb, salt);
+    mrb_ary_push(mrb, hold, password);
+    mrb_ary_push(mrb, hold, salt);
+
+    kdf_pbkdf2_job_set(mrb, &jobs[i], password, salt, iterations, length, digest);
+    key = mrb_str_new(mrb, NULL, jobs[i].length);
+    jobs[i].output = (unsigned char *)RSTRING_PTR(key);
+    mrb_ary_push(mrb, keys, key);
+    mrb_gc_arena_restore(mrb, ai);
+  }
+
+  kdf_pbkdf2_run_all(mrb, jobs, count);
+
+  for (i = 0; i < count; i++) {
+    if (jobs[i].ret != 0) {
+      mrb_raise(mrb, E_RUNTIME_ERROR, "PBKDF2 derivation failed");
+    }
+  }
+
+  return keys;
+}
+#endif
+
+#if defined(MRB_POLARSSL_AES_PARALLEL)
+#define AES_MODE_CTR 0
+#define AES_MODE_GCM 1
+#define AES_MIN_SEGMENT (64 * 1024)
+#define AES_MAX_SEGMENTS 64
+#define AES_FILE_CHUNK (1024 * 1024)
+#define AES_GCM_MAX_LENGTH 0xFFFFFFFE0ULL
+
+/*
+ * Keyed once on the caller thread; the workers only read it. Successive
+ * aes_stream_update() calls continue the counter and the running GHASH, so
+ * every call but the last must be a multiple of 16 bytes.
+ */
+typedef struct {
+  int mode;
+  int decrypt;
+  mrb_int segments;
+  uint64_t blocks;
+  uint64_t length;
+  unsigned char iv[16];
+  unsigned char h[16];
+  unsigned char x[16];
+  aes_context aes;
+  gcm_context gcm;
+} aes_stream;
+
+typedef struct {
+  const aes_stream *stream;
+  const unsigned char *input;
+  unsigned char *output;
+  size_t length;
+  uint64_t block;
+  unsigned char ghash[16];
+  int ret;
+} aes_segment;
+
+#if defined(POLARSSL_CIPHER_MODE_CTR)
+static void aes_counter_add(unsigned char counter[16], uint64_t blocks) {
+  int i;
+
+  for (i = 15; i >= 0 && blocks != 0; i--) {
+    blocks += counter[i];
+    counter[i] = (unsigned char)(blocks & 0xFF);
+    blocks >>= 8;
+  }
+}
+
+static void aes_segment_ctr(aes_segment *seg) {
+  unsigned char counter[16], stream_block[16];
+  size_t nc_off = 0;
+
+  memcpy(counter, seg->stream->iv, 16);
+  aes_counter_add(counter, seg->block);
+  /* aes_crypt_ctr() only reads the shared, already expanded key. */
+  seg->ret = aes_crypt_ctr((aes_context *)&seg->stream->aes, seg->length, &nc_off,
+      counter, stream_block, seg->input, seg->output);
+}
+#endif
+
+#if defined(POLARSSL_GCM_C)
+/* Also leaves the partial GHASH of the segment ciphertext in seg->ghash. */
+static void aes_segment_gcm(aes_segment *seg) {
+  gcm_context gcm;
+  uint32_t y;
+
+  /*
+   * A shallow copy of the started context: its cipher context still points
+   * at the shared key schedule, which gcm_update() only reads. The copy must
+   * not be passed to gcm_free().
+   */
+  gcm = seg->stream->gcm;
+
+  /* gcm_update() only steps the low 32 bits of the counter block (inc32). */
+  y = ((uint32_t)gcm.y[12] << 24) | ((uint32_t)gcm.y[13] << 16) |
+      ((uint32_t)gcm.y[14] << 8) | (uint32_t)gcm.y[15];
+  y += (uint32_t)seg->block;
+  gcm.y[12] = (unsigned char)(y >> 24);
+  gcm.y[13] = (unsigned char)(y >> 16);
+  gcm.y[14] = (unsigned char)(y >> 8);
+  gcm.y[15] = (unsigned char)y;
+  seg->ret = gcm_update(&gcm, seg->length, seg->input, seg->output);
+  memcpy(seg->ghash, gcm.buf, 16);
+}
+
+/* Multiplication in GF(2^128) as defined for GHASH (NIST SP 800-38D, 6.3). */
+static void gf128_mul(unsigned char x[16], const unsigned char y[16]) {
+  unsigned char z[16], v[16];
+  int i, j, lsb;
+
+  memset(z, 0, sizeof(z));
+  memcpy(v, y, 16);
+  for (i = 0; i < 128; i++) {
+    if (x[i / 8] & (0x80 >> (i % 8))) {
+      for (j = 0; j < 16; j++) z[j] ^= v[j];
+    }
+    lsb = v[15] & 1;
+    for (j = 15; j > 0; j--) {
+      v[j] = (unsigned char)((v[j] >> 1) | (v[j - 1] << 7));
+    }
+    v[0] >>= 1;
+    if (lsb) v[0] ^= 0xE1;
+  }
+  memcpy(x, z, 16);
+}
+
+/* x = x * h^n */
+static void gf128_mul_pow(unsigned char x[16], const unsigned char h[16], uint64_t n) {
+  unsigned char p[16];
+
+  memcpy(p, h, 16);
+  while (n != 0) {
+    if (n & 1) gf128_mul(x, p);
+    n >>= 1;
+    if (n != 0) gf128_mul(p, p);
+  }
+}
+
+/* Appends the length block to the running GHASH and masks it with E(K, J0). */
+static void aes_stream_tag(aes_stream *st, unsigned char tag[16]) {
+  unsigned char x[16];
+  uint64_t bits = st->length * 8;
+  int j;
+
+  memcpy(x, st->x, 16);
+  for (j = 0; j < 8; j++) {
+    x[15 - j] ^= (unsigned char)(bits >> (j * 8));
+  }
+  gf128_mul(x, st->h);
+  for (j = 0; j < 16; j++) tag[j] = x[j] ^ st->gcm.base_ectr[j];
+}
+#endif
+
+/* Encrypts or decrypts one counter-aligned segment. */
+static void *aes_segment_run(void *arg) {
+  aes_segment *seg = arg;
+
+#if defined(POLARSSL_CIPHER_MODE_CTR)
+  if (seg->stream->mode == AES_MODE_CTR) aes_segment_ctr(seg);
+#endif
+#if defined(POLARSSL_GCM_C)
+  if (seg->stream->mode == AES_MODE_GCM) aes_segment_gcm(seg);
+#endif
+  return NULL;
+}
+
+/*
+ * All key setup happens here, on the caller thread, so PolarSSL's lazily
+ * built AES tables and AES-NI detection are initialised before any worker
+ * runs. aes_stream_free() is safe to call whatever this returns.
+ */
+static int aes_stream_setup(aes_stream *st, int mode, int decrypt, mrb_int segments,
+    mrb_value key, mrb_value iv) {
+  const unsigned char *k = (const unsigned char *)RSTRING_PTR(key);
+  unsigned int keybits = (unsigned int)RSTRING_LEN(key) * 8;
+  int ret;
+
+  memset(st, 0, sizeof(aes_stream));
+  st->mode     = mode;
+  st->decrypt  = decrypt;
+  st->segments = segments;
+  aes_init(&st->aes);
+
+  ret = aes_setkey_enc(&st->aes, k, keybits);
+  if (ret != 0 || mode != AES_MODE_GCM) {
+    if (mode == AES_MODE_CTR) memcpy(st->iv, RSTRING_PTR(iv), 16);
+    return ret;
+  }
+
+#if defined(POLARSSL_GCM_C)
+  ret = aes_crypt_ecb(&st->aes, AES_ENCRYPT, st->h, st->h);
+  if (ret == 0) {
+    ret = gcm_init(&st->gcm, POLARSSL_CIPHER_ID_AES, k, keybits);
+  }
+  if (ret == 0) {
+    ret = gcm_starts(&st->gcm, decrypt ? GCM_DECRYPT : GCM_ENCRYPT,
+        (const unsigned char *)RSTRING_PTR(iv), RSTRING_LEN(iv), NULL, 0);
+  }
+#endif
+  return ret;
+}
+
+static void aes_stream_free(aes_stream *st) {
+  aes_free(&st->aes);
+#if defined(POLARSSL_GCM_C)
+  if (st->mode == AES_MODE_GCM) gcm_free(&st->gcm);
+#endif
+}
+
+/* Splits input into 16-byte aligned segments and runs them in parallel. Never raises. */
+static int aes_stream_update(aes_stream *st, const unsigned char *input,
+    unsigned char *output, size_t length) {
+  aes_segment segs[AES_MAX_SEGMENTS];
+  size_t seglen, offset;
+  mrb_int count, i;
+  int ret = 0;
+
+  count = st->segments;
+  if (count < 1) {
+    count = worker_count((mrb_int)((length + AES_MIN_SEGMENT - 1) / AES_MIN_SEGMENT));
+  }
+  if (count < 1) count = 1;
+  if (count > AES_MAX_SEGMENTS) count = AES_MAX_SEGMENTS;
+  seglen = ((length + count - 1) / count + 15) & ~(size_t)15;
+
+  for (i = 0, offset = 0; i < count; i++, offset += seglen) {
+    segs[i].stream = st;
+    segs[i].length = offset >= length ? 0 : (length - offset < seglen ? length - offset : seglen);
+    segs[i].input  = segs[i].length > 0 ? input + offset : input;
+    segs[i].output = segs[i].length > 0 ? output + offset : output;
+    segs[i].block  = st->blocks + offset / 16;
+    segs[i].ret    = 0;
+  }
+
+  run_workers(aes_segment_run, segs, sizeof(aes_segment), count);
+
+  for (i = 0; i < count && ret == 0; i++) {
+    ret = segs[i].ret;
+  }
+#if defined(POLARSSL_GCM_C)
+  /* GHASH(A || B) = GHASH(A) * H^blocks(B) ^ GHASH(B) */
+  for (i = 0; i < count && ret == 0 && st->mode == AES_MODE_GCM; i++) {
+    int j;
+
+    gf128_mul_pow(st->x, st->h, (segs[i].length + 15) / 16);
+    for (j = 0; j < 16; j++) st->x[j] ^= segs[i].ghash[j];
+  }
+#endif
+  st->blocks += (length + 15) / 16;
+  st->length += length;
+  return ret;
+}
+
+/* Only the modes compiled into this build are accepted. */
+static int aes_mode(mrb_state *mrb, mrb_value mode) {
+#if defined(POLARSSL_CIPHER_MODE_CTR)
+  if (mrb_str_cmp(mrb, mode, mrb_str_new_lit(mrb, "CTR")) == 0) {
+    return AES_MODE_CTR;
+  }
+#endif
+#if defined(POLARSSL_GCM_C)
+  if (mrb_str_cmp(mrb, mode, mrb_str_new_lit(mrb, "GCM")) == 0) {
+    return AES_MODE_GCM;
+  }
+#endif
+  mrb_raisef(mrb, E_CIPHER_ERROR, "unsupported AES mode: %S", mode);
+  return -1;
+}
+
+static void aes_check_args(mrb_state *mrb, int mode, int decrypt, mrb_value key,
+    mrb_value iv, mrb_value tag, mrb_int segments, uint64_t length) {
+  if (RSTRING_LEN(key) != 16 && RSTRING_LEN(key) != 24 && RSTRING_LEN(key) != 32) {
+    mrb_raise(mrb, E_CIPHER_ERROR, "AES key must be 16, 24 or 32 bytes");
+  }
+  if (mode == AES_MODE_CTR && RSTRING_LEN(iv) != 16) {
+    mrb_raise(mrb, E_CIPHER_ERROR, "AES-CTR iv must be 16 bytes");
+  }
+  if (mode == AES_MODE_GCM && RSTRING_LEN(iv) == 0) {
+    mrb_raise(mrb, E_CIPHER_ERROR, "AES-GCM iv must not be empty");
+  }
+  if (mode == AES_MODE_GCM && length > AES_GCM_MAX_LENGTH) {
+    mrb_raise(mrb, E_CIPHER_ERROR, "input too long for AES-GCM");
+  }
+  if (mode == AES_MODE_GCM && decrypt &&
+      (!mrb_string_p(tag) || RSTRING_LEN(tag) != 16)) {
+    mrb_raise(mrb, E_CIPHER_ERROR, "AES-GCM decryption needs a 16 byte tag");
+  }
+  if (segments < 0 || segments > AES_MAX_SEGMENTS) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "segments out of range");
+  }
+}
+
+/* Constant-time comparison, so a forged tag learns nothing from timing. */
+static int aes_tag_equal(const unsigned char *a, const unsigned char *b) {
+  unsigned char diff = 0;
+  int i;
+
+  for (i = 0; i < 16; i++) diff |= a[i] ^ b[i];
+  return diff == 0;
+}
+
+/*
+ * AES.encrypt_buffer(mode, key, data, iv[, segments]) => [output, tag]
+ * AES.decrypt_buffer(mode, key, data, iv, tag[, segments]) => output
+ *
+ * segments forces the number of parallel segments; 0 picks one per CPU.
+ */
+static mrb_value aes_crypt_buffer(mrb_state *mrb, int decrypt) {
+  mrb_value mode, key, source, iv, tag = mrb_nil_value(), dest;
+  unsigned char computed[16] = { 0 };
+  mrb_int segments = 0;
+  aes_stream st;
+  int aes, ret;
+
+  if (decrypt) {
+    mrb_get_args(mrb, "SSSSo|i", &mode, &key, &source, &iv, &tag, &segments);
+  } else {
+    mrb_get_args(mrb, "SSSS|i", &mode, &key, &source, &iv, &segments);
+  }
+
+  aes = aes_mode(mrb, mode);
+  aes_check_args(mrb, aes, decrypt, key, iv, tag, segments, RSTRING_LEN(source));
+
+  dest = mrb_str_new(mrb, NULL, RSTRING_LEN(source));
+
+  ret = aes_stream_setup(&st, aes, decrypt, segments, key, iv);
+  if (ret == 0) {
+    ret = aes_stream_update(&st, (const unsigned char *)RSTRING_PTR(source),
+        (unsigned char *)RSTRING_PTR(dest), RSTRING_LEN(source));
+  }
+#if defined(POLARSSL_GCM_C)
+  if (ret == 0 && aes == AES_MODE_GCM) aes_stream_tag(&st, computed);
+#endif
+  aes_stream_free(&st);
+
+  if (ret != 0) {
+    mrb_raise(mrb, E_CIPHER_ERROR, "AES operation failed");
+  }
+  if (aes != AES_MODE_GCM) {
+    return decrypt ? dest : mrb_assoc_new(mrb, dest, mrb_nil_value());
+  }
+  if (decrypt) {
+    if (!aes_tag_equal(computed, (const unsigned char *)RSTRING_PTR(tag))) {
+      mrb_raise(mrb, E_CIPHER_ERROR, "AES-GCM authentication failed");
+    }
+    return dest;
+  }
+  return mrb_assoc_new(mrb, dest, mrb_str_new(mrb, (char *)computed, 16));
+}
+
+static mrb_value mrb_aes_encrypt_buffer(mrb_state *mrb, mrb_value self) {
+  return aes_crypt_buffer(mrb, 0);
+}
+
+static mrb_value mrb_aes_decrypt_buffer(mrb_state *mrb, mrb_value self) {
+  return aes_crypt_buffer(mrb, 1);
+}
+
+#if !defined(_WIN32)
+typedef struct {
+  int in_fd;
+  int out_fd;
+  void *in_map;
+  void *out_map;
+  size_t map_len;
+  unsigned char *buf;
+  const char *out_name;
+  int unlink_out;
+} aes_file;
+
+/* Releases everything; on failure also removes the partially written output. */
+static void aes_file_close(aes_file *f, int failed) {
+  if (f->in_map != MAP_FAILED) munmap(f->in_map, f->map_len);
+  if (f->out_map != MAP_FAILED) munmap(f->out_map, f->map_len);
+  if (f->in_fd >= 0) close(f->in_fd);
+  if (f->out_fd >= 0) close(f->out_fd);
+  free(f->buf);
+  if (failed && f->unlink_out) unlink(f->out_name);
+}
+
+static void aes_file_fail(mrb_state *mrb, aes_file *f, const char *what) {
+  int err = errno;
+
+  aes_file_close(f, 1);
+  errno = err;
+  mrb_sys_fail(mrb, what);
+}
+
+static void aes_file_raise(mrb_state *mrb, aes_file *f, const char *msg) {
+  aes_file_close(f, 1);
+  mrb_raise(mrb, E_CIPHER_ERROR, msg);
+}
+
+/*
+ * Allocates the output's blocks before it is mmap'd. Returns 0 or an errno
+ * value; without posix_fallocate() the caller falls back to read/write.
+ */
+#if defined(_POSIX_ADVISORY_INFO) && _POSIX_ADVISORY_INFO > 0
+#define AES_FILE_CAN_RESERVE 1
+static int aes_file_reserve(int fd, off_t len) {
+  int ret;
+
+  do {
+    ret = posix_fallocate(fd, 0, len);
+  } while (ret == EINTR);
+  return ret;
+}
+#else
+#define AES_FILE_CAN_RESERVE 0
+static int aes_file_reserve(int fd, off_t len) {
+  (void)fd;
+  (void)len;
+  return ENOSYS;
+}
+#endif
+
+/* Reads until len bytes or EOF, so only the final chunk is short. */
+static ssize_t aes_read_full(int fd, unsigned char *buf, size_t len) {
+  size_t done = 0;
+  ssize_t n;
+
+  while (done < len) {
+    n = read(fd, buf + done, len - done);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) return -1;
+    if (n == 0) break;
+    done += n;
+  }
+  return (ssize_t)done;
+}
+
+static int aes_write_full(int fd, const unsigned char *buf, size_t len) {
+  size_t done = 0;
+  ssize_t n;
+
+  while (done < len) {
+    n = write(fd, buf + done, len - done);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) return -1;
+    done += n;
+  }
+  return 0;
+}
+
+/*
+ * AES.encrypt_file(mode, key, in_path, out_path, iv[, segments]) => tag
+ * AES.decrypt_file(mode, key, in_path, out_path, iv, tag[, segments]) => nil
+ *
+ * Regular files are mmap'd on both sides. Pipes, FIFOs and other streams are
+ * read in chunks that are each split across the workers; GCM decryption still
+ * needs a regular output so unauthenticated plaintext can be removed.
+ */
+static mrb_value aes_crypt_file(mrb_state *mrb, int decrypt) {
+  mrb_value mode, key, in_path, out_path, iv, tag = mrb_nil_value();
+  unsigned char computed[16] = { 0 };
+  const char *in_name, *out_name, *io_what = NULL;
+  mrb_int segments = 0, workers;
+  struct stat in_st, out_st;
+  int aes, ret, use_map, io_err = 0, too_long = 0;
+  size_t chunk;
+  ssize_t n;
+  aes_stream st;
+  aes_file f;
+
+  if (decrypt) {
+    mrb_get_args(mrb, "SSSSSo|i", &mode, &key, &in_path, &out_path, &iv, &tag, &segments);
+  } else {
+    mrb_get_args(mrb, "SSSSS|i", &mode, &key, &in_path, &out_path, &iv, &segments);
+  }
+
+  aes = aes_mode(mrb, mode);
+  aes_check_args(mrb, aes, decrypt, key, iv, tag, segments, 0);
+  in_name  = mrb_str_to_cstr(mrb, in_path);
+  out_name = mrb_str_to_cstr(mrb, out_path);
+
+  f.in_fd = f.out_fd = -1;
+  f.in_map = f.out_map = MAP_FAILED;
+  f.map_len = 0;
+  f.buf = NULL;
+  f.out_name = out_name;
+  f.unlink_out = 0;
+
+  f.in_fd = open(in_name, O_RDONLY);
+  if (f.in_fd < 0 || fstat(f.in_fd, &in_st) != 0) {
+    aes_file_fail(mrb, &f, in_name);
+  }
+  /* Not O_TRUNC: the output may be the input under another name. */
+  f.out_fd = open(out_name, O_RDWR | O_CREAT, 0644);
+  if (f.out_fd < 0) {
+    f.out_fd = open(out_name, O_WRONLY | O_CREAT, 0644);
+  }
+  if (f.out_fd < 0 || fstat(f.out_fd, &out_st) != 0) {
+    aes_file_fail(mrb, &f, out_name);
+  }
+  if (in_st.st_dev == out_st.st_dev && in_st.st_ino == out_st.st_ino) {
+    aes_file_raise(mrb, &f, "input and output are the same file");
+  }
+  /*
+   * A stream cannot take back plaintext once it is written, and the tag is
+   * only known at the end, so GCM decryption needs an output it can unlink.
+   */
+  if (aes == AES_MODE_GCM && decrypt && !S_ISREG(out_st.st_mode)) {
+    aes_file_raise(mrb, &f, "AES-GCM decryption needs a regular output file");
+  }
+  if (aes == AES_MODE_GCM && S_ISREG(in_st.st_mode) &&
+      (uint64_t)in_st.st_size > AES_GCM_MAX_LENGTH) {
+    aes_file_raise(mrb, &f, "input file too large for AES-GCM");
+  }
+  /* Every argument check is done; only now is an existing output emptied. */
+  if (S_ISREG(out_st.st_mode)) {
+    if (ftruncate(f.out_fd, 0) != 0) {
+      aes_file_fail(mrb, &f, out_name);
+    }
+    f.unlink_out = 1;
+  }
+
+  use_map = AES_FILE_CAN_RESERVE && S_ISREG(in_st.st_mode) && S_ISREG(out_st.st_mode) &&
+    in_st.st_size > 0 && (off_t)(size_t)in_st.st_size == in_st.st_size &&
+    (fcntl(f.out_fd, F_GETFL) & O_ACCMODE) == O_RDWR;
+
+  if (use_map) {
+    /*
+     * The blocks behind the shared mapping are allocated up front: writing
+     * to a sparse file on a full disk raises SIGBUS instead of an error.
+     */
+    ret = aes_file_reserve(f.out_fd, in_st.st_size);
+    if (ret == EINVAL || ret == EOPNOTSUPP || ret == ENOSYS) {
+      use_map = 0;
+    } else if (ret != 0) {
+      errno = ret;
+      aes_file_fail(mrb, &f, out_name);
+    }
+  }
+  if (use_map) {
+    f.map_len = (size_t)in_st.st_size;
+    f.in_map = mmap(NULL, f.map_len, PROT_READ, MAP_SHARED, f.in_fd, 0);
+    if (f.in_map == MAP_FAILED) {
+      aes_file_fail(mrb, &f, in_name);
+    }
+    f.out_map = mmap(NULL, f.map_len, PROT_READ | PROT_WRITE, MAP_SHARED, f.out_fd, 0);
+    if (f.out_map == MAP_FAILED) {
+      aes_file_fail(mrb, &f, out_name);
+    }
+  } else {
+    workers = segments > 0 ? segments : worker_count(AES_MAX_SEGMENTS);
+    chunk   = AES_FILE_CHUNK * (size_t)(workers > 0 ? workers : 1);
+    f.buf   = (unsigned char *)malloc(chunk);
+    if (f.buf == NULL) {
+      errno = ENOMEM;
+      aes_file_fail(mrb, &f, "malloc");
+    }
+  }
+
+  ret = aes_stream_setup(&st, aes, decrypt, segments, key, iv);
+  if (ret == 0 && use_map) {
+    ret = aes_stream_update(&st, f.in_map, f.out_map, f.map_len);
+  }
+  while (ret == 0 && !use_map) {
+    n = aes_read_full(f.in_fd, f.buf, chunk);
+    if (n < 0) {
+      io_err = errno;
+      io_what = in_name;
+      break;
+    }
+    if (aes == AES_MODE_GCM && st.length + (uint64_t)n > AES_GCM_MAX_LENGTH) {
+      too_long = 1;
+      break;
+    }
+    ret = aes_stream_update(&st, f.buf, f.buf, (size_t)n);
+    if (ret == 0 && aes_write_full(f.out_fd, f.buf, (size_t)n) != 0) {
+      io_err = errno;
+      io_what = out_name;
+      break;
+    }
+    if ((size_t)n < chunk) break;
+  }
+#if defined(POLARSSL_GCM_C)
+  if (ret == 0 && aes == AES_MODE_GCM) aes_stream_tag(&st, computed);
+#endif
+  aes_stream_free(&st);
+
+  if (io_err != 0) {
+    errno = io_err;
+    aes_file_fail(mrb, &f, io_what);
+  }
+  if (too_long) {
+    aes_file_raise(mrb, &f, "input too long for AES-GCM");
+  }
+  if (ret != 0) {
+    aes_file_raise(mrb, &f, "AES operation failed");
+  }
+  if (aes == AES_MODE_GCM && decrypt &&
+      !aes_tag_equal(computed, (const unsigned char *)RSTRING_PTR(tag))) {
+    aes_file_raise(mrb, &f, "AES-GCM authentication failed");
+  }
+  aes_file_close(&f, 0);
+
+  if (aes == AES_MODE_GCM && !decrypt) {
+    return mrb_str_new(mrb, (char *)computed, 16);
+  }
+  return mrb_nil_value();
+}
+
+static mrb_value mrb_aes_encrypt_file(mrb_state *mrb, mrb_value self) {
+  return aes_crypt_file(mrb, 0);
+}
+
+static mrb_value mrb_aes_decrypt_file(mrb_state *mrb, mrb_value self) {
+  return aes_crypt_file(mrb, 1);
+}
+#endif
+#endif
 
 void mrb_mruby_polarssl_gem_init(mrb_state *mrb) {
-  struct RClass *p, *e, *c, *s, *pkey, *ecdsa, *cipher, *des, *des3, *base64;
+  struct RClass *p, *e, *c;
+#if defined(POLARSSL_DES_C) || defined(MRB_POLARSSL_AES_PARALLEL)
+  struct RClass *cipher;
+#endif
+#if defined(POLARSSL_SSL_TLS_C)
+  struct RClass *s;
+#endif
+#if defined(POLARSSL_ECDSA_C)
+  struct RClass *pkey, *ecdsa;
+#endif
+#if defined(POLARSSL_DES_C)
+  struct RClass *des, *des3;
+#endif
+#if defined(MRB_POLARSSL_AES_PARALLEL)
+  struct RClass *aes;
+  mrb_value modes;
+#endif
+#if defined(POLARSSL_BASE64_C)
+  struct RClass *base64;
+#endif
+#if defined(POLARSSL_PKCS5_C)
+  struct RClass *kdf;
+#endif
 
   p = mrb_define_module(mrb, "PolarSSL");
+#if defined(POLARSSL_ECDSA_C)
   pkey = mrb_define_module_under(mrb, p, "PKey");
+#else
+  mrb_define_module_under(mrb, p, "PKey");
+#endif
 
   e = mrb_define_class_under(mrb, p, "Entropy", mrb->object_class);
   MRB_SET_INSTANCE_TT(e, MRB_TT_DATA);
@@ -654,8 +1592,11 @@ void mrb_mruby_polarssl_gem_init(mrb_state *mrb) {
   c = mrb_define_class_under(mrb, p, "CtrDrbg", mrb->object_class);
   MRB_SET_INSTANCE_TT(c, MRB_TT_DATA);
   mrb_define_method(mrb, c, "initialize", mrb_ctrdrbg_initialize, MRB_ARGS_REQ(1) | MRB_ARGS_OPT(1));
+#if defined(POLARSSL_SELF_TEST)
   mrb_define_singleton_method(mrb, (struct RObject*)c, "self_test", mrb_ctrdrbg_self_test, MRB_ARGS_NONE());
+#endif
 
+#if defined(POLARSSL_SSL_TLS_C)
   s = mrb_define_class_under(mrb, p, "SSL", mrb->object_class);
   MRB_SET_INSTANCE_TT(s, MRB_TT_DATA);
   mrb_define_method(mrb, s, "initialize", mrb_ssl_initialize, MRB_ARGS_NONE());
@@ -678,7 +1619,9 @@ void mrb_mruby_polarssl_gem_init(mrb_state *mrb) {
   mrb_define_method(mrb, s, "fileno", mrb_ssl_fileno, MRB_ARGS_NONE());
   mrb_define_method(mrb, s, "close_notify", mrb_ssl_close_notify, MRB_ARGS_NONE());
   mrb_define_method(mrb, s, "close", mrb_ssl_close, MRB_ARGS_NONE());
+#endif
 
+#if defined(POLARSSL_ECDSA_C)
   ecdsa = mrb_define_class_under(mrb, pkey, "EC", mrb->object_class);
   MRB_SET_INSTANCE_TT(ecdsa, MRB_TT_DATA);
   mrb_define_method(mrb, ecdsa, "alloc", mrb_ecdsa_alloc, MRB_ARGS_NONE());
@@ -687,9 +1630,15 @@ void mrb_mruby_polarssl_gem_init(mrb_state *mrb) {
   mrb_define_method(mrb, ecdsa, "public_key", mrb_ecdsa_public_key, MRB_ARGS_NONE());
   mrb_define_method(mrb, ecdsa, "private_key", mrb_ecdsa_private_key, MRB_ARGS_NONE());
   mrb_define_method(mrb, ecdsa, "sign", mrb_ecdsa_sign, MRB_ARGS_REQ(1));
+#endif
 
+#if defined(POLARSSL_DES_C) || defined(MRB_POLARSSL_AES_PARALLEL)
   cipher = mrb_define_class_under(mrb, p, "Cipher", mrb->object_class);
+#else
+  mrb_define_class_under(mrb, p, "Cipher", mrb->object_class);
+#endif
 
+#if defined(POLARSSL_DES_C)
   des = mrb_define_class_under(mrb, cipher, "DES", cipher);
   mrb_define_class_method(mrb, des, "encrypt", mrb_des_encrypt, MRB_ARGS_REQ(4));
   mrb_define_class_method(mrb, des, "decrypt", mrb_des_decrypt, MRB_ARGS_REQ(4));
@@ -697,10 +1646,38 @@ void mrb_mruby_polarssl_gem_init(mrb_state *mrb) {
   des3 = mrb_define_class_under(mrb, cipher, "DES3", cipher);
   mrb_define_class_method(mrb, des3, "encrypt", mrb_des3_encrypt, MRB_ARGS_REQ(4));
   mrb_define_class_method(mrb, des3, "decrypt", mrb_des3_decrypt, MRB_ARGS_REQ(4));
+#endif
 
+#if defined(MRB_POLARSSL_AES_PARALLEL)
+  aes = mrb_define_class_under(mrb, cipher, "AES", cipher);
+  modes = mrb_ary_new(mrb);
+#if defined(POLARSSL_CIPHER_MODE_CTR)
+  mrb_ary_push(mrb, modes, mrb_str_new_lit(mrb, "CTR"));
+#endif
+#if defined(POLARSSL_GCM_C)
+  mrb_ary_push(mrb, modes, mrb_str_new_lit(mrb, "GCM"));
+#endif
+  // Modes compiled into this build.
+  mrb_define_const(mrb, aes, "MODES", modes);
+  mrb_define_class_method(mrb, aes, "encrypt_buffer", mrb_aes_encrypt_buffer, MRB_ARGS_REQ(4) | MRB_ARGS_OPT(1));
+  mrb_define_class_method(mrb, aes, "decrypt_buffer", mrb_aes_decrypt_buffer, MRB_ARGS_REQ(5) | MRB_ARGS_OPT(1));
+#if !defined(_WIN32)
+  mrb_define_class_method(mrb, aes, "encrypt_file", mrb_aes_encrypt_file, MRB_ARGS_REQ(5) | MRB_ARGS_OPT(1));
+  mrb_define_class_method(mrb, aes, "decrypt_file", mrb_aes_decrypt_file, MRB_ARGS_REQ(6) | MRB_ARGS_OPT(1));
+#endif
+#endif
+
+#if defined(POLARSSL_BASE64_C)
   base64 = mrb_define_module_under(mrb, p, "Base64");
   mrb_define_class_method(mrb, base64, "encode", mrb_base64_encode, MRB_ARGS_REQ(1));
   mrb_define_class_method(mrb, base64, "decode", mrb_base64_decode, MRB_ARGS_REQ(1));
+#endif
+
+#if defined(POLARSSL_PKCS5_C)
+  kdf = mrb_define_module_under(mrb, p, "KDF");
+  mrb_define_class_method(mrb, kdf, "pbkdf2", mrb_kdf_pbkdf2, MRB_ARGS_REQ(4) | MRB_ARGS_OPT(1));
+  mrb_define_class_method(mrb, kdf, "pbkdf2_many", mrb_kdf_pbkdf2_many, MRB_ARGS_REQ(1));
+#endif
 }
 
 void mrb_mruby_polarssl_gem_final(mrb_state *mrb) {
@@ -1,32 +1,34 @@
-class Base64Test < MTest::Unit::TestCase
-  TEST_DATA = [
-      {
-          :src => 'ruby',
-          :dst => 'cnVieQ=='
-      },
-      {
-          :src => 'Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor incididunt ut labore et dolore magna aliqua. Ut enim ad minim veniam, quis nostrud exercitation ullamco laboris nisi ut aliquip ex ea commodo consequat. Duis aute irure dolor in reprehenderit in voluptate velit esse cillum dolore eu fugiat nulla pariatur. Excepteur sint occaecat cupidatat non proident, sunt in culpa qui officia deserunt mollit anim id est laborum.',
-          :dst => 'TG9yZW0gaXBzdW0gZG9sb3Igc2l0IGFtZXQsIGNvbnNlY3RldHVyIGFkaXBpc2NpbmcgZWxpdCwgc2VkIGRvIGVpdXNtb2QgdGVtcG9yIGluY2lkaWR1bnQgdXQgbGFib3JlIGV0IGRvbG9yZSBtYWduYSBhbGlxdWEuIFV0IGVuaW0gYWQgbWluaW0gdmVuaWFtLCBxdWlzIG5vc3RydWQgZXhlcmNpdGF0aW9uIHVsbGFtY28gbGFib3JpcyBuaXNpIHV0IGFsaXF1aXAgZXggZWEgY29tbW9kbyBjb25zZXF1YXQuIER1aXMgYXV0ZSBpcnVyZSBkb2xvciBpbiByZXByZWhlbmRlcml0IGluIHZvbHVwdGF0ZSB2ZWxpdCBlc3NlIGNpbGx1bSBkb2xvcmUgZXUgZnVnaWF0IG51bGxhIHBhcmlhdHVyLiBFeGNlcHRldXIgc2ludCBvY2NhZWNhdCBjdXBpZGF0YXQgbm9uIHByb2lkZW50LCBzdW50IGluIGN1bHBhIHF1aSBvZmZpY2lhIGRlc2VydW50IG1vbGxpdCBhbmltIGlkIGVzdCBsYWJvcnVtLg=='
-      }
-  ]
+if PolarSSL.const_defined?(:Base64)
+  class Base64Test < MTest::Unit::TestCase
+    TEST_DATA = [
+        {
+            :src => 'ruby',
+            :dst => 'cnVieQ=='
+        },
+        {
+            :src => 'Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor incididunt ut labore et dolore magna aliqua. Ut enim ad minim veniam, quis nostrud exercitation ullamco laboris nisi ut aliquip ex ea commodo consequat. Duis aute irure dolor in reprehenderit in voluptate velit esse cillum dolore eu fugiat nulla pariatur. Excepteur sint occaecat cupidatat non proident, sunt in culpa qui officia deserunt mollit anim id est laborum.',
+            :dst => 'TG9yZW0gaXBzdW0gZG9sb3Igc2l0IGFtZXQsIGNvbnNlY3RldHVyIGFkaXBpc2NpbmcgZWxpdCwgc2VkIGRvIGVpdXNtb2QgdGVtcG9yIGluY2lkaWR1bnQgdXQgbGFib3JlIGV0IGRvbG9yZSBtYWduYSBhbGlxdWEuIFV0IGVuaW0gYWQgbWluaW0gdmVuaWFtLCBxdWlzIG5vc3RydWQgZXhlcmNpdGF0aW9uIHVsbGFtY28gbGFib3JpcyBuaXNpIHV0IGFsaXF1aXAgZXggZWEgY29tbW9kbyBjb25zZXF1YXQuIER1aXMgYXV0ZSBpcnVyZSBkb2xvciBpbiByZXByZWhlbmRlcml0IGluIHZvbHVwdGF0ZSB2ZWxpdCBlc3NlIGNpbGx1bSBkb2xvcmUgZXUgZnVnaWF0IG51bGxhIHBhcmlhdHVyLiBFeGNlcHRldXIgc2ludCBvY2NhZWNhdCBjdXBpZGF0YXQgbm9uIHByb2lkZW50LCBzdW50IGluIGN1bHBhIHF1aSBvZmZpY2lhIGRlc2VydW50IG1vbGxpdCBhbmltIGlkIGVzdCBsYWJvcnVtLg=='
+        }
+    ]
 
-  assert('PolarSSL::Base64') do
-    PolarSSL::Base64.class == Module
-  end
+    assert('PolarSSL::Base64') do
+      PolarSSL::Base64.class == Module
+    end
 
-  assert('PolarSSL::Base64.encode') do
-    TEST_DATA.each do |data|
-      expected = data[:dst]
-      actual = PolarSSL::Base64.encode(data[:src])
-      assert_equal(expected, actual)
+    assert('PolarSSL::Base64.encode') do
+      TEST_DATA.each do |data|
+        expected = data[:dst]
+        actual = PolarSSL::Base64.encode(data[:src])
+        assert_equal(expected, actual)
+      end
     end
-  end
 
-  assert('PolarSSL::Base64.decode') do
-    TEST_DATA.each do |data|
-      expected = data[:src]
-      actual = PolarSSL::Base64.decode(data[:dst])
-      assert_equal(expected, actual)
+    assert('PolarSSL::Base64.decode') do
+      TEST_DATA.each do |data|
+        expected = data[:src]
+        actual = PolarSSL::Base64.decode(data[:dst])
+        assert_equal(expected, actual)
+      end
     end
   end
 end
@@ -1,67 +1,233 @@
 
 class CipherTest < MTest::Unit::TestCase
-  def test_cipher_encrypt_des_cbc
-    cipher = PolarSSL::Cipher.new("DES-CBC")
-    cipher.encrypt
-    cipher.key = "0123456789ABCDEF"
-    cipher.iv  = "fedcba9876543210"
-    assert_equal "CCD173FFAB2039F4ACD8AEFDDFD8A1EB468E91157888BA68",
-      cipher.update("37363534333231204E6F77206973207468652074696D6520")
-  end
+  if PolarSSL::Cipher.const_defined?(:DES)
+    def test_cipher_encrypt_des_cbc
+      cipher = PolarSSL::Cipher.new("DES-CBC")
+      cipher.encrypt
+      cipher.key = "0123456789ABCDEF"
+      cipher.iv  = "fedcba9876543210"
+      assert_equal "CCD173FFAB2039F4ACD8AEFDDFD8A1EB468E91157888BA68",
+        cipher.update("37363534333231204E6F77206973207468652074696D6520")
+    end
 
-  def test_cipher_encrypt_des_ecb
-    cipher = PolarSSL::Cipher.new("DES-ECB")
-    cipher.encrypt
-    cipher.key = "0123456789ABCDEF"
-    assert_equal "17668DFC7292532D", cipher.update("1111111111111111")
-  end
+    def test_cipher_encrypt_des_ecb
+      cipher = PolarSSL::Cipher.new("DES-ECB")
+      cipher.encrypt
+      cipher.key = "0123456789ABCDEF"
+      assert_equal "17668DFC7292532D", cipher.update("1111111111111111")
+    end
 
-  def test_cipher_encrypt_3des_cbc
-    cipher = PolarSSL::Cipher.new("DES3-CBC")
-    cipher.encrypt
-    cipher.key = "0123456789abcdeff1e0d3c2b5a49786fedcba9876543210"
-    cipher.iv  = "fedcba9876543210"
-    assert_equal "3FE301C962AC01D02213763C1CBD4CDC799657C064ECF5D4",
-      cipher.update("37363534333231204E6F77206973207468652074696D6520")
-  end
+    def test_cipher_encrypt_3des_cbc
+      cipher = PolarSSL::Cipher.new("DES3-CBC")
+      cipher.encrypt
+      cipher.key = "0123456789abcdeff1e0d3c2b5a49786fedcba9876543210"
+      cipher.iv  = "fedcba9876543210"
+      assert_equal "3FE301C962AC01D02213763C1CBD4CDC799657C064ECF5D4",
+        cipher.update("37363534333231204E6F77206973207468652074696D6520")
+    end
 
-  def test_cipher_encrypt_3des_ecb
-    cipher = PolarSSL::Cipher.new("DES3-ECB")
-    cipher.encrypt
-    cipher.key = "0000000000000000FFFFFFFFFFFFFFFF"
-    assert_equal "9295B59BB384736E", cipher.update("0000000000000000")
-  end
+    def test_cipher_encrypt_3des_ecb
+      cipher = PolarSSL::Cipher.new("DES3-ECB")
+      cipher.encrypt
+      cipher.key = "0000000000000000FFFFFFFFFFFFFFFF"
+      assert_equal "9295B59BB384736E", cipher.update("0000000000000000")
+    end
+
+    def test_cipher_decrypt_des_cbc
+      cipher = PolarSSL::Cipher.new("DES-CBC")
+      cipher.decrypt
+      cipher.key = "0123456789ABCDEF"
+      cipher.iv  = "fedcba9876543210"
+      assert_equal "37363534333231204E6F77206973207468652074696D6520",
+        cipher.update("CCD173FFAB2039F4ACD8AEFDDFD8A1EB468E91157888BA68")
+    end
+
+    def test_cipher_decrypt_des_ecb
+      cipher = PolarSSL::Cipher.new("DES-ECB")
+      cipher.decrypt
+      cipher.key = "0123456789ABCDEF"
+      assert_equal "1111111111111111", cipher.update("17668DFC7292532D")
+    end
 
-  def test_cipher_decrypt_des_cbc
-    cipher = PolarSSL::Cipher.new("DES-CBC")
-    cipher.decrypt
-    cipher.key = "0123456789ABCDEF"
-    cipher.iv  = "fedcba9876543210"
-    assert_equal "37363534333231204E6F77206973207468652074696D6520",
-      cipher.update("CCD173FFAB2039F4ACD8AEFDDFD8A1EB468E91157888BA68")
+    def test_cipher_decrypt_3des_cbc
+      cipher = PolarSSL::Cipher.new("DES3-CBC")
+      cipher.decrypt
+      cipher.key = "0123456789abcdeff1e0d3c2b5a49786fedcba9876543210"
+      cipher.iv  = "fedcba9876543210"
+      assert_equal "37363534333231204E6F77206973207468652074696D6520",
+        cipher.update("3FE301C962AC01D02213763C1CBD4CDC799657C064ECF5D4")
+    end
+
+    def test_cipher_decrypt_3des_ecb
+      cipher = PolarSSL::Cipher.new("DES3-ECB")
+      cipher.decrypt
+      cipher.key = "0000000000000000FFFFFFFFFFFFFFFF"
+      assert_equal "0000000000000000", cipher.update("9295B59BB384736E")
+    end
   end
 
-  def test_cipher_decrypt_des_ecb
-    cipher = PolarSSL::Cipher.new("DES-ECB")
-    cipher.decrypt
-    cipher.key = "0123456789ABCDEF"
-    assert_equal "1111111111111111", cipher.update("17668DFC7292532D")
+  if PolarSSL::Cipher.ciphers.include?("AES-CTR")
+    def test_cipher_encrypt_aes_ctr
+      cipher = PolarSSL::Cipher.new("AES-CTR")
+      cipher.encrypt
+      cipher.key = "2b7e151628aed2a6abf7158809cf4f3c"
+      cipher.iv  = "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff"
+      assert_equal "874D6191B620E3261BEF6864990DB6CE",
+        cipher.update("6bc1bee22e409f96e93d7e117393172a")
+    end
+
+    def test_cipher_decrypt_aes_ctr
+      cipher = PolarSSL::Cipher.new("AES-CTR")
+      cipher.decrypt
+      cipher.key = "2b7e151628aed2a6abf7158809cf4f3c"
+      cipher.iv  = "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff"
+      assert_equal "6BC1BEE22E409F96E93D7E117393172A",
+        cipher.update("874d6191b620e3261bef6864990db6ce")
+    end
+
+    def test_cipher_encrypt_buffer_aes_ctr_roundtrip
+      cipher = PolarSSL::Cipher.new("AES-CTR")
+      cipher.encrypt
+      cipher.key = "2b7e151628aed2a6abf7158809cf4f3c"
+      cipher.iv  = "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff"
+      data = "0123456789" * 30001
+      output = cipher.encrypt_buffer(data)
+      assert_nil cipher.tag
+      cipher.decrypt
+      assert_equal data, cipher.decrypt_buffer(output)
+      [3, 7].each do |segments|
+        assert_equal output, PolarSSL::Cipher::AES.encrypt_buffer("CTR", cipher.bkey, data, cipher.biv, segments).first
+      end
+    end
+
+    def test_cipher_file_same_path
+      path = "polarssl_test_#{rand(1000000)}.in"
+      File.open(path, "w") { |f| f.write("a" * 1000) }
+      cipher = PolarSSL::Cipher.new("AES-CTR")
+      cipher.encrypt
+      cipher.key = "2b7e151628aed2a6abf7158809cf4f3c"
+      cipher.iv  = "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff"
+      assert_raise(PolarSSL::CipherError) { cipher.encrypt_file(path, path) }
+      assert_equal "a" * 1000, File.open(path) { |f| f.read }
+    ensure
+      File.unlink(path) if File.exist?(path)
+    end
   end
 
-  def test_cipher_decrypt_3des_cbc
-    cipher = PolarSSL::Cipher.new("DES3-CBC")
-    cipher.decrypt
-    cipher.key = "0123456789abcdeff1e0d3c2b5a49786fedcba9876543210"
-    cipher.iv  = "fedcba9876543210"
-    assert_equal "37363534333231204E6F77206973207468652074696D6520",
-      cipher.update("3FE301C962AC01D02213763C1CBD4CDC799657C064ECF5D4")
+  if PolarSSL::Cipher.ciphers.include?("AES-GCM")
+    def test_cipher_encrypt_aes_gcm
+      cipher = PolarSSL::Cipher.new("AES-GCM")
+      cipher.encrypt
+      cipher.key = "00000000000000000000000000000000"
+      cipher.iv  = "000000000000000000000000"
+      assert_equal "0388DACE60B6A392F328C2B971B2FE78AB6E47D42CEC13BDF53A67B21257BDDF",
+        cipher.update("00000000000000000000000000000000")
+    end
+
+    def test_cipher_encrypt_buffer_aes_gcm_empty
+      cipher = PolarSSL::Cipher.new("AES-GCM")
+      cipher.encrypt
+      cipher.key = "00000000000000000000000000000000"
+      cipher.iv  = "000000000000000000000000"
+      assert_equal "", cipher.encrypt_buffer("")
+      assert_equal "58e2fccefa7e3061367f1d57a4e7455a", cipher.tag.unpack("H*").first
+    end
+
+    def test_cipher_decrypt_aes_gcm
+      cipher = PolarSSL::Cipher.new("AES-GCM")
+      cipher.decrypt
+      cipher.key = "00000000000000000000000000000000"
+      cipher.iv  = "000000000000000000000000"
+      assert_equal "00000000000000000000000000000000",
+        cipher.update("0388dace60b6a392f328c2b971b2fe78ab6e47d42cec13bdf53a67b21257bddf")
+    end
+
+    def test_cipher_decrypt_aes_gcm_bad_tag
+      cipher = PolarSSL::Cipher.new("AES-GCM")
+      cipher.decrypt
+      cipher.key = "00000000000000000000000000000000"
+      cipher.iv  = "000000000000000000000000"
+      assert_raise(PolarSSL::CipherError) do
+        cipher.update("0388dace60b6a392f328c2b971b2fe78ab6e47d42cec13bdf53a67b21257bdde")
+      end
+    end
+
+    def test_cipher_encrypt_buffer_needs_encrypt
+      cipher = PolarSSL::Cipher.new("AES-GCM")
+      cipher.decrypt
+      cipher.key = "00000000000000000000000000000000"
+      cipher.iv  = "000000000000000000000000"
+      assert_raise(PolarSSL::CipherError) { cipher.encrypt_buffer("a" * 16) }
+    end
+
+    def test_cipher_encrypt_buffer_aes_gcm_segments
+      key, iv = "\0" * 16, "\0" * 12
+      [1, 3, 8].each do |segments|
+        output, tag = PolarSSL::Cipher::AES.encrypt_buffer("GCM", key, "a" * 300000, iv, segments)
+        assert_equal 300000, output.size
+        assert_equal "8c07a5e65b721f4844dc51a72fad842f", output[-16, 16].unpack("H*").first
+        assert_equal "3ce12b3d4f4103820f48217985f8566a", tag.unpack("H*").first
+      end
+    end
+
+    def test_cipher_encrypt_buffer_aes_gcm_empty_trailing_segment
+      # 33 bytes over 4 segments: 16, 16, 1 and an empty trailing segment.
+      output, tag = PolarSSL::Cipher::AES.encrypt_buffer("GCM", "\0" * 16, "a" * 33, "\0" * 12, 4)
+      assert_equal "62e9bbaf01d7c2f39249a3d810d39f1996f4cbca282a3842969ce89ef5eaa08141",
+        output.unpack("H*").first
+      assert_equal "85b286b0e7b6bf8588e96237636be1f5", tag.unpack("H*").first
+      assert_equal "a" * 33,
+        PolarSSL::Cipher::AES.decrypt_buffer("GCM", "\0" * 16, output, "\0" * 12, tag, 4)
+    end
+
+    def test_cipher_buffer_aes_gcm_roundtrip
+      data = "0123456789" * 30001
+      cipher = PolarSSL::Cipher.new("AES-GCM")
+      cipher.encrypt
+      cipher.key = "000102030405060708090a0b0c0d0e0f"
+      cipher.iv  = "cafebabefacedbaddecaf888"
+      output = cipher.encrypt_buffer(data)
+      tag = cipher.tag
+
+      cipher.decrypt
+      cipher.tag = tag
+      assert_equal data, cipher.decrypt_buffer(output)
+      cipher.tag = "\0" * 16
+      assert_raise(PolarSSL::CipherError) { cipher.decrypt_buffer(output) }
+    end
+
+    def test_cipher_file_aes_gcm
+      in_path  = "polarssl_test_#{rand(1000000)}.in"
+      out_path = "#{in_path}.enc"
+      dec_path = "#{in_path}.dec"
+      File.open(in_path, "w") { |f| f.write("a" * 300000) }
+      cipher = PolarSSL::Cipher.new("AES-GCM")
+      cipher.encrypt
+      cipher.key = "00000000000000000000000000000000"
+      cipher.iv  = "000000000000000000000000"
+      assert_equal true, cipher.encrypt_file(in_path, out_path)
+      assert_equal "3ce12b3d4f4103820f48217985f8566a", cipher.tag.unpack("H*").first
+      assert_equal cipher.encrypt_buffer("a" * 300000), File.open(out_path) { |f| f.read }
+
+      cipher.decrypt
+      assert_equal true, cipher.decrypt_file(out_path, dec_path)
+      assert_equal "a" * 300000, File.open(dec_path) { |f| f.read }
+      assert_raise(PolarSSL::CipherError) { cipher.decrypt_file(out_path, "/dev/null") }
+
+      File.unlink(dec_path)
+      cipher.tag = "\0" * 16
+      assert_raise(PolarSSL::CipherError) { cipher.decrypt_file(out_path, dec_path) }
+      assert_equal false, File.exist?(dec_path)
+    ensure
+      [in_path, out_path, dec_path].each { |path| File.unlink(path) if File.exist?(path) }
+    end
   end
 
-  def test_cipher_decrypt_3des_ecb
-    cipher = PolarSSL::Cipher.new("DES3-ECB")
-    cipher.decrypt
-    cipher.key = "0000000000000000FFFFFFFFFFFFFFFF"
-    assert_equal "0000000000000000", cipher.update("9295B59BB384736E")
+  if PolarSSL::Cipher.const_defined?(:AES)
+    def test_cipher_ciphers_match_aes_modes
+      aes = PolarSSL::Cipher.ciphers.select { |c| c.start_with?("AES-") }
+      assert_equal PolarSSL::Cipher::AES::MODES.map { |mode| "AES-#{mode}" }, aes
+    end
   end
 end
 
@@ -0,0 +1,60 @@
+if PolarSSL.const_defined?(:KDF)
+  class KDFTest < MTest::Unit::TestCase
+    def test_pbkdf2_sha1
+      key = PolarSSL::KDF.pbkdf2("password", "salt", 2, 20, :digest => "SHA1")
+      assert_equal "ea6c014dc72d6f8ccd1ed92ace1d41f0d8de8957", key.unpack("H*").first
+    end
+
+    def test_pbkdf2_sha256_by_default
+      key = PolarSSL::KDF.pbkdf2("password", "salt", 1, 32)
+      assert_equal "120fb6cffcf8b32c43e7225256c4f837a86548c92ccc35480805987cb70be17b",
+        key.unpack("H*").first
+    end
+
+    def test_pbkdf2_unknown_digest
+      assert_raise(ArgumentError) do
+        PolarSSL::KDF.pbkdf2("password", "salt", 1, 32, :digest => "FOO")
+      end
+    end
+
+    def test_pbkdf2_many
+      keys = PolarSSL::KDF.pbkdf2_many([
+        ["password", "salt", 1, 20, "SHA1"],
+        ["password", "salt", 2, 20, "SHA1"],
+        ["password", "salt", 1, 32]
+      ])
+      assert_equal [
+        "0c60c80f961f0e71f3a9b524af6012062fe037a6",
+        "ea6c014dc72d6f8ccd1ed92ace1d41f0d8de8957",
+        "120fb6cffcf8b32c43e7225256c4f837a86548c92ccc35480805987cb70be17b"
+      ], keys.map { |key| key.unpack("H*").first }
+    end
+
+    def test_pbkdf2_iterations_out_of_range
+      big = 4294967296 + 1
+      return unless big.kind_of?(Fixnum)
+      assert_raise(ArgumentError) do
+        PolarSSL::KDF.pbkdf2("password", "salt", big, 20)
+      end
+      assert_raise(ArgumentError) do
+        PolarSSL::KDF.pbkdf2_many([["password", "salt", big, 20]])
+      end
+    end
+
+    def test_pbkdf2_many_invalid_entry
+      assert_raise(ArgumentError) do
+        PolarSSL::KDF.pbkdf2_many([["password", "salt", 1, 20], ["password", "salt"]])
+      end
+    end
+
+    def test_pbkdf2_many_empty
+      assert_equal [], PolarSSL::KDF.pbkdf2_many([])
+    end
+  end
+end
+
+if $ok_test
+  MTest::Unit.new.mrbtest
+else
+  MTest::Unit.new.run
+end